@@ -120,7 +120,9 @@ extern "C" {
 
 /*
  The named color spaces provided by Nanocolor are as follows.
- Note that the names are shared with libraries such as MaterialX.
+ Note that the names are shared with libraries such as MaterialX. Names used
+ for them elsewhere, such as in OpenColorIO configs, are also recognized by
+ NcGetNamedColorSpace as aliases.
 
  - acescg:           The Academy Color Encoding System, a color space designed
                      for cinematic content creation and exchange, using AP1 primaries
@@ -169,8 +171,13 @@ NCEXTERNC const char* Nc_srgb_texture;
 #define NcColorSpaceEqual            NCCONCAT(NCNAMESPACE, ColorSpaceEqual)
 #define NcCreateColorSpace           NCCONCAT(NCNAMESPACE, CreateColorSpace)
 #define NcCreateColorSpaceM33        NCCONCAT(NCNAMESPACE, CreateColorSpaceM33)
+#define NcFindLinearColorSpace       NCCONCAT(NCNAMESPACE, FindLinearColorSpace)
 #define NcFreeColorSpace             NCCONCAT(NCNAMESPACE, FreeColorSpace)
+#define NcGetColorSpaceById          NCCONCAT(NCNAMESPACE, GetColorSpaceById)
 #define NcGetColorSpaceDescriptor    NCCONCAT(NCNAMESPACE, GetColorSpaceDescriptor)
+#define NcGetColorSpaceId            NCCONCAT(NCNAMESPACE, GetColorSpaceId)
+#define NcGetColorSpaceIdLimit       NCCONCAT(NCNAMESPACE, GetColorSpaceIdLimit)
+#define NcGetColorSpaceGeneration    NCCONCAT(NCNAMESPACE, GetColorSpaceGeneration)
 #define NcGetColorSpaceM33Descriptor NCCONCAT(NCNAMESPACE, GetColorSpaceM33Descriptor)
 #define NcGetDescription             NCCONCAT(NCNAMESPACE, GetDescription)
 #define NcGetK0Phi                   NCCONCAT(NCNAMESPACE, GetK0Phi)
@@ -179,15 +186,18 @@ NCEXTERNC const char* Nc_srgb_texture;
 #define NcGetRGBToXYZMatrix          NCCONCAT(NCNAMESPACE, GetRGBtoXYZMatrix)
 #define NcGetXYZToRGBMatrix          NCCONCAT(NCNAMESPACE, GetXYZtoRGBMatrix)
 #define NcInitColorSpaceLibrary      NCCONCAT(NCNAMESPACE, InitColorSpaceLibrary)
+#define NcRegisterColorSpace         NCCONCAT(NCNAMESPACE, RegisterColorSpace)
+#define NcRegisterColorSpaceAlias    NCCONCAT(NCNAMESPACE, RegisterColorSpaceAlias)
 #define NcMatchLinearColorSpace      NCCONCAT(NCNAMESPACE, MatchLinearColorSpace)
 #define NcRegisteredColorSpaceNames  NCCONCAT(NCNAMESPACE, RegisteredColorSpaceNames)
+#define NcUnregisterColorSpace       NCCONCAT(NCNAMESPACE, UnregisterColorSpace)
 
 /**
  * @brief Initializes the color space library.
  * 
- * Initializes the color spaces provided in the built-in color space library. 
- * This function is not thread-safe and must be called before NcGetNamedColorSpace
- * is called.
+ * The built-in color spaces are precomputed constant data, so there is
+ * nothing left to initialize, and this function does nothing. It remains
+ * so that existing callers continue to work.
  * 
  * @return void
  */
@@ -196,24 +206,132 @@ NCAPI void NcInitColorSpaceLibrary(void);
 /**
  * @brief Retrieves the names of the registered color spaces.
  * 
- * Retrieves the names of the color spaces that have been registered.
- * This function must not be called before NcInitColorSpaceLibrary is called.
+ * Retrieves the names of the built-in color spaces, followed by those
+ * registered with NcRegisterColorSpace. The array is terminated by NULL.
+ * It is a snapshot; it doesn't change when a color space is registered or
+ * unregistered, and may be read while other threads do so. Each name is
+ * valid until its color space is freed.
  * 
  * @return Pointer to an array of strings containing the names of the registered color spaces.
  */
 NCAPI const char** NcRegisteredColorSpaceNames(void);
 
+/**
+ * @brief Registers a color space so that it can be found by name.
+ * 
+ * Makes a color space created by NcCreateColorSpace or NcCreateColorSpaceM33
+ * available to NcGetNamedColorSpace under the name in its descriptor. The
+ * registry does not take ownership; the color space stays registered until
+ * it is unregistered or freed with NcFreeColorSpace. Registration fails if
+ * the name is empty, or already names a built-in or registered color space.
+ * Registering is safe to do while other threads look up color spaces,
+ * unless Nanocolor was built with NC_NO_THREADS, in which case calls that
+ * register and unregister must not overlap.
+ * 
+ * @param cs Pointer to the color space object to register.
+ * @return True if the color space was registered, false otherwise.
+ */
+NCAPI bool NcRegisterColorSpace(const NcColorSpace* cs);
+
+/**
+ * @brief Adds an alias for a color space name.
+ * 
+ * Adds another name, matched regardless of case, by which NcGetNamedColorSpace
+ * finds the built-in or registered color space with the given name. The
+ * color space need not be registered yet. Aliases are kept for the life of
+ * the process. Adding an alias fails if the alias is empty or already in
+ * use. It is safe to add aliases while other threads look up color spaces.
+ * 
+ * @param alias The alias, which is copied.
+ * @param name The name of the color space the alias refers to, which is copied.
+ * @return True if the alias was added, false otherwise.
+ */
+NCAPI bool NcRegisterColorSpaceAlias(const char* alias, const char* name);
+
+/**
+ * @brief Removes a color space from the registry.
+ * 
+ * Removes a color space registered with NcRegisterColorSpace, so that its
+ * name is no longer found. The color space itself is not freed. A color
+ * space must not be freed while another thread may still be using it,
+ * whether or not it was found through the registry.
+ * 
+ * @param cs Pointer to the color space object to unregister.
+ * @return True if the color space was registered, false otherwise.
+ */
+NCAPI bool NcUnregisterColorSpace(const NcColorSpace* cs);
+
 /**
  * @brief Retrieves a named color space.
  * 
- * Retrieves a color space object based on the provided name.
- * This function must not be called before NcInitColorSpaceLibrary is called.
+ * Retrieves a color space object based on the provided name, which may be
+ * a built-in color space or one registered with NcRegisterColorSpace. If
+ * no color space has the name, it is looked up as an alias, regardless of
+ * case. The common names used by MaterialX, OpenColorIO and ACES configs,
+ * and OpenUSD, such as "ACES - ACEScg", "srgb_tx", "Utility - Linear - sRGB"
+ * and "lin_rec709_scene", are built in aliases, as are the built-in color
+ * space names themselves, so that "ACEScg" finds acescg. Names are found
+ * by hashing, so the cost doesn't grow with the number of color spaces or
+ * aliases. It is safe to call from any number of threads at once, and
+ * takes no locks.
  * 
  * @param name The name of the color space to retrieve.
  * @return Pointer to the color space object, or NULL if not found.
  */
 NCAPI const NcColorSpace* NcGetNamedColorSpace(const char* name);
 
+/**
+ * @brief Retrieves a color space's ID.
+ * 
+ * Every built-in and registered color space has a small integer ID, so that
+ * hosts can compare color spaces with an integer compare, and index flat
+ * arrays, such as a table of transforms by source and destination, by ID.
+ * The built-in color spaces have the lowest IDs, which never change. A
+ * registered color space is given the lowest ID not in use, and keeps it
+ * until it is unregistered, after which the ID may be given to another.
+ * Hosts caching by ID must therefore either evict a color space's entries
+ * when they unregister or free it, or store its generation with each entry
+ * and check it, as returned by NcGetColorSpaceGeneration.
+ * 
+ * @param cs Pointer to the color space object.
+ * @return The color space's ID, or -1 if it is neither built in nor registered.
+ */
+NCAPI int NcGetColorSpaceId(const NcColorSpace* cs);
+
+/**
+ * @brief Retrieves a color space by its ID.
+ * 
+ * @param id The ID of the color space, as returned by NcGetColorSpaceId.
+ * @return Pointer to the color space object, or NULL if no color space has the ID.
+ */
+NCAPI const NcColorSpace* NcGetColorSpaceById(int id);
+
+/**
+ * @brief Retrieves a bound on the color space IDs.
+ * 
+ * Every color space ID is less than the returned value, which is suitable
+ * for sizing arrays indexed by ID. It grows as color spaces are registered,
+ * and never shrinks.
+ * 
+ * @return One more than the largest ID a color space may currently have.
+ */
+NCAPI int NcGetColorSpaceIdLimit(void);
+
+/**
+ * @brief Retrieves the generation of a color space's registration.
+ * 
+ * Each registration is given a generation that no other registration has,
+ * so that an entry cached by ID, with the generation stored alongside it,
+ * can be told apart from a color space given the same ID later. An entry is
+ * current if NcGetColorSpaceGeneration(NcGetColorSpaceById(id)) returns
+ * the generation stored with it.
+ * 
+ * @param cs Pointer to the color space object.
+ * @return The generation, or 0 for built-in color spaces and color spaces
+ *         that aren't registered.
+ */
+NCAPI unsigned int NcGetColorSpaceGeneration(const NcColorSpace* cs);
+
 /**
  * Creates a color space object based on the provided color space descriptor.
  * 
@@ -236,7 +354,8 @@ NCAPI const NcColorSpace* NcCreateColorSpaceM33(const NcColorSpaceM33Descriptor*
  * 
  * Frees the memory associated with a color space object. 
  * If this function is called on one of the built in library color spaces, it will
- * return without freeing the memory.
+ * return without freeing the memory. A registered color space is unregistered
+ * before it is freed.
  * 
  * @param cs Pointer to the color space object to be freed.
  * @return void
@@ -261,6 +380,7 @@ NCAPI NcM33f NcGetXYZToRGBMatrix(const NcColorSpace* cs);
 
 /**
  * Retrieves the RGB to RGB transformation matrix from source to destination color space.
+ * Between spaces sharing a gamut it is exactly the identity.
  * 
  * @param src Pointer to the source color space object.
  * @param dst Pointer to the destination color space object.
@@ -270,6 +390,8 @@ NCAPI NcM33f NcGetRGBToRGBMatrix(const NcColorSpace* src, const NcColorSpace* ds
 
 /**
  * Checks if two color space objects are equal by comparing their properties.
+ * Two built in or registered color spaces are equal only if they have the
+ * same ID.
  * 
  * @param cs1 Pointer to the first color space object.
  * @param cs2 Pointer to the second color space object.
@@ -330,9 +452,10 @@ NCAPI void NcGetK0Phi(const NcColorSpace* cs, float* K0, float* phi);
 /**
  * @brief Matches a linear color space based on specified primaries and white point.
  * 
- * Returns a string describing the color space that best matches the specified primaries
- * and white point. A reasonable epsilon for the comparison is 1e-4 because most color 
- * spaces are defined to that precision.
+ * Returns the name of the linear color space, built-in or registered, that best matches
+ * the specified primaries and white point, as NcFindLinearColorSpace does. A reasonable
+ * epsilon for the comparison is 1e-4 because most color spaces are defined to that
+ * precision.
  * 
  * @param redPrimary Red primary chromaticity.
  * @param greenPrimary Green primary chromaticity.
@@ -347,6 +470,34 @@ NCAPI const char* NcMatchLinearColorSpace(NcChromaticity redPrimary,
                                           NcChromaticity whitePoint,
                                           float epsilon);
 
+/**
+ * @brief Finds the linear color space closest to specified primaries and white point.
+ * 
+ * Finds the linear color space, built-in or registered, whose primaries and white
+ * point are closest to those specified. The distance is the largest difference in
+ * any of the eight chromaticity coordinates, and the closest color space is returned
+ * if its distance is less than epsilon. If two color spaces are equally close, the
+ * one with the lower ID is returned, so that built-in color spaces are preferred.
+ * 
+ * Results are remembered, so that matching the same chromaticities again, such as
+ * those in the header of every image in a sequence, costs a single hash lookup.
+ * 
+ * @param redPrimary Red primary chromaticity.
+ * @param greenPrimary Green primary chromaticity.
+ * @param bluePrimary Blue primary chromaticity.
+ * @param whitePoint White point chromaticity.
+ * @param epsilon Distance the match must be within.
+ * @param distance If not NULL, receives the distance of the closest linear color
+ *                 space, even if it is not within epsilon.
+ * @return Pointer to the matched color space object, or NULL if none is within epsilon.
+ */
+NCAPI const NcColorSpace* NcFindLinearColorSpace(NcChromaticity redPrimary,
+                                                 NcChromaticity greenPrimary,
+                                                 NcChromaticity bluePrimary,
+                                                 NcChromaticity whitePoint,
+                                                 float epsilon,
+                                                 float* distance);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,279 @@
+//
+// Copyright 2024 Pixar
+//
+// Licensed under the Apache License, Version 2.0 (the "Apache License")
+// with the following modification; you may not use this file except in
+// compliance with the Apache License and the following modification to it:
+// Section 6. Trademarks. is deleted and replaced with:
+//
+// 6. Trademarks. This License does not grant permission to use the trade
+//    names, trademarks, service marks, or product names of the Licensor
+//    and its affiliates, except as required to comply with Section 4(c) of
+//    the License and to reproduce the content of the NOTICE file.
+//
+// You may obtain a copy of the Apache License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the Apache License with the above modification is
+// distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied. See the Apache License for the specific
+// language governing permissions and limitations under the Apache License.
+//
+
+/*
+    Checks the accuracies documented for NcGetRGBToRGBTransformWithAccuracy.
+    Every float in [2^-14, 64] is decoded and encoded through each of the
+    built in transfer curves at each accuracy, and compared with the
+    reference curve evaluated with powf. Every 8 and 16 bit code is checked
+    as well, as those are exact at every accuracy. Build it with nanocolor.c,
+
+        cc -O2 nanocolorAccuracy.c nanocolor.c -lm -lpthread
+
+    and optionally give a stride, such as 97, to check every 97th float for
+    a quicker run. It prints the largest error found for each curve, and
+    exits with 1 if any is outside its documented bound. The kernels checked
+    are those chosen for the machine it runs on.
+*/
+
+#include "nanocolor.h"
+#include "nanocolorProcessing.h"
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NC_ACCURACY_CHUNK (3 * 4096)
+
+typedef struct {
+    const char* name;
+    NcAccuracy  accuracy;
+    double      bound;      // the largest relative error documented
+} _NcAccuracyBound;
+
+// The bounds for the built in curves, which are all pure powers or sRGB
+// style curves.
+static const _NcAccuracyBound _ncAccuracyBounds[] = {
+    { "exact",       NcAccuracyExact,       0.0  },
+    { "fast",        NcAccuracyFast,        1e-6 },
+    { "approximate", NcAccuracyApproximate, 7e-6 },
+};
+#define NC_ACCURACY_COUNT (sizeof(_ncAccuracyBounds) / sizeof(_ncAccuracyBounds[0]))
+
+// A transfer curve, evaluated as the reference curves are.
+typedef struct {
+    float gamma, linearBias, K0, phi;
+} _NcRefCurve;
+
+static float _NcRefToLinear(const _NcRefCurve* c, float t) {
+    if (t < c->K0)
+        return t / c->phi;
+    return powf((t + c->linearBias) / (1.f + c->linearBias), c->gamma);
+}
+
+static float _NcRefFromLinear(const _NcRefCurve* c, float t) {
+    if (t < c->K0 / c->phi)
+        return t * c->phi;
+    return (1.f + c->linearBias) * powf(t, 1.f / c->gamma) - c->linearBias;
+}
+
+static float _NcRefCurveEval(const _NcRefCurve* c, bool toLinear, float t) {
+    return toLinear ? _NcRefToLinear(c, t) : _NcRefFromLinear(c, t);
+}
+
+static uint16_t _NcRefQuantizeU16(float v) {
+    v = v * 65535.f + 0.5f;
+    v = v >= 0.f ? v : 0.f;
+    v = v <= 65535.f ? v : 65535.f;
+    return (uint16_t) v;
+}
+
+static uint8_t _NcRefQuantizeU8(float v) {
+    v = v * 255.f + 0.5f;
+    v = v >= 0.f ? v : 0.f;
+    v = v <= 255.f ? v : 255.f;
+    return (uint8_t) v;
+}
+
+static float _NcFloatFromBits(uint32_t u) {
+    float f;
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+// Errors are relative, and only results that are normal floats count.
+static double _NcRelativeError(float v, float ref) {
+    if (!(fabsf(ref) >= FLT_MIN))
+        return 0.0;
+    if (v != v)
+        return INFINITY;
+    return fabs((double) v - (double) ref) / fabs((double) ref);
+}
+
+static bool _NcReport(const char* space, const char* check, size_t a,
+                      double error, float at) {
+    const double bound = _ncAccuracyBounds[a].bound;
+    const bool ok = error <= bound;
+    printf("%-16s %-10s %-12s %9.3g at %-14.9g bound %-6.3g %s\n", space, check,
+           _ncAccuracyBounds[a].name, error, at, bound, ok ? "ok" : "FAILED");
+    return ok;
+}
+
+static bool _NcReportCodes(const char* space, const char* check, size_t a, size_t errors) {
+    printf("%-16s %-10s %-12s %9zu codes differ %22s\n", space, check,
+           _ncAccuracyBounds[a].name, errors, errors ? "FAILED" : "ok");
+    return !errors;
+}
+
+// Sweeps every stride'th float in [2^-14, 64] through one direction of a
+// curve at each accuracy. Encoding is also checked when writing 8 bits, which
+// must give exactly the reference rounded.
+static bool _NcCheckFloats(const char* space, const _NcRefCurve* curve, bool toLinear,
+                           const NcColorTransform** xf, uint32_t stride) {
+    static float in[NC_ACCURACY_CHUNK], out[NC_ACCURACY_CHUNK], ref[NC_ACCURACY_CHUNK];
+    static uint8_t out8[NC_ACCURACY_CHUNK];
+    double error[NC_ACCURACY_COUNT] = { 0 };
+    float at[NC_ACCURACY_COUNT] = { 0 };
+    size_t u8Errors[NC_ACCURACY_COUNT] = { 0 };
+
+    const uint32_t first = 0x38800000u;  // 2^-14
+    const uint32_t last = 0x42800000u;   // 64
+    for (uint32_t bits = first; bits <= last;) {
+        size_t n = 0;
+        for (; n < NC_ACCURACY_CHUNK && bits <= last; n++, bits += stride) {
+            in[n] = _NcFloatFromBits(bits);
+            ref[n] = _NcRefCurveEval(curve, toLinear, in[n]);
+        }
+        // pad to whole colors with the last value
+        for (; n % 3; n++) {
+            in[n] = in[n - 1];
+            ref[n] = ref[n - 1];
+        }
+
+        for (size_t a = 0; a < NC_ACCURACY_COUNT; a++) {
+            NcApplyTransformOutOfPlace(xf[a], (const NcRGB*) in, (NcRGB*) out, n / 3);
+            for (size_t i = 0; i < n; i++) {
+                const double e = _NcRelativeError(out[i], ref[i]);
+                if (e > error[a]) {
+                    error[a] = e;
+                    at[a] = in[i];
+                }
+            }
+            if (!toLinear) {
+                NcApplyTransformToU8(xf[a], in, out8, 3, n / 3);
+                for (size_t i = 0; i < n; i++)
+                    u8Errors[a] += out8[i] != _NcRefQuantizeU8(ref[i]);
+            }
+        }
+    }
+
+    bool ok = true;
+    for (size_t a = 0; a < NC_ACCURACY_COUNT; a++)
+        ok &= _NcReport(space, toLinear ? "decode" : "encode", a, error[a], at[a]);
+    if (!toLinear)
+        for (size_t a = 0; a < NC_ACCURACY_COUNT; a++)
+            ok &= _NcReportCodes(space, "encode u8", a, u8Errors[a]);
+    return ok;
+}
+
+// Checks every 8 bit code decoded, and every 16 bit code decoded and encoded,
+// at each accuracy. Each must be exactly the reference, rounded to 16 bits
+// when writing 16 bit codes.
+static bool _NcCheckCodes(const char* space, const _NcRefCurve* curve,
+                          const NcColorTransform** decode, const NcColorTransform** encode) {
+    static uint8_t in8[256 * 3];
+    static uint16_t in16[65536 * 3], out16[65536 * 3];
+    static float out[256 * 3];
+    for (int i = 0; i < 256 * 3; i++)
+        in8[i] = (uint8_t) (i / 3);
+    for (int i = 0; i < 65536 * 3; i++)
+        in16[i] = (uint16_t) (i / 3);
+
+    bool ok = true;
+    for (size_t a = 0; a < NC_ACCURACY_COUNT; a++) {
+        size_t errors = 0;
+        NcApplyTransformU8(decode[a], in8, out, 3, 256);
+        for (int i = 0; i < 256 * 3; i++)
+            errors += out[i] != _NcRefToLinear(curve, (float) in8[i] / 255.f);
+        ok &= _NcReportCodes(space, "decode u8", a, errors);
+
+        errors = 0;
+        NcApplyTransformU16(decode[a], in16, out16, 3, 65536);
+        for (int i = 0; i < 65536 * 3; i++)
+            errors += out16[i] != _NcRefQuantizeU16(_NcRefToLinear(curve, (float) in16[i] / 65535.f));
+        ok &= _NcReportCodes(space, "decode u16", a, errors);
+
+        errors = 0;
+        NcApplyTransformU16(encode[a], in16, out16, 3, 65536);
+        for (int i = 0; i < 65536 * 3; i++)
+            errors += out16[i] != _NcRefQuantizeU16(_NcRefFromLinear(curve, (float) in16[i] / 65535.f));
+        ok &= _NcReportCodes(space, "encode u16", a, errors);
+    }
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    uint32_t stride = 1;
+    if (argc == 2)
+        stride = (uint32_t) strtoul(argv[1], NULL, 10);
+    if (!stride || stride > (1u << 24)) {
+        printf("usage: %s [stride, from 1 to 2^24]\n", argv[0]);
+        return 1;
+    }
+
+    // Built in spaces sharing a curve are only checked once.
+    _NcRefCurve checked[64];
+    size_t checkedCount = 0;
+    bool ok = true;
+
+    const char** names = NcRegisteredColorSpaceNames();
+    for (size_t s = 0; names[s]; s++) {
+        const NcColorSpace* cs = NcGetNamedColorSpace(names[s]);
+        NcColorSpaceDescriptor desc;
+        if (!NcGetColorSpaceDescriptor(cs, &desc) || desc.gamma == 1.f)
+            continue;
+
+        _NcRefCurve curve = { desc.gamma, desc.linearBias, 0.f, 0.f };
+        NcGetK0Phi(cs, &curve.K0, &curve.phi);
+        bool seen = false;
+        for (size_t i = 0; i < checkedCount; i++)
+            seen |= !memcmp(&checked[i], &curve, sizeof(curve));
+        if (seen || checkedCount == sizeof(checked) / sizeof(checked[0]))
+            continue;
+        checked[checkedCount++] = curve;
+
+        // the same gamut without a curve, so that only the curve is applied
+        NcColorSpaceDescriptor linearDesc = desc;
+        linearDesc.name = "nanocolorAccuracy linear";
+        linearDesc.gamma = 1.f;
+        linearDesc.linearBias = 0.f;
+        const NcColorSpace* linear = NcCreateColorSpace(&linearDesc);
+        if (!linear) {
+            printf("couldn't create a linear %s\n", names[s]);
+            return 1;
+        }
+
+        const NcColorTransform* decode[NC_ACCURACY_COUNT];
+        const NcColorTransform* encode[NC_ACCURACY_COUNT];
+        for (size_t a = 0; a < NC_ACCURACY_COUNT; a++) {
+            decode[a] = NcGetRGBToRGBTransformWithAccuracy(cs, linear, _ncAccuracyBounds[a].accuracy);
+            encode[a] = NcGetRGBToRGBTransformWithAccuracy(linear, cs, _ncAccuracyBounds[a].accuracy);
+        }
+
+        ok &= _NcCheckFloats(names[s], &curve, true, decode, stride);
+        ok &= _NcCheckFloats(names[s], &curve, false, encode, stride);
+        ok &= _NcCheckCodes(names[s], &curve, decode, encode);
+        fflush(stdout);
+
+        for (size_t a = 0; a < NC_ACCURACY_COUNT; a++) {
+            NcFreeColorTransform(decode[a]);
+            NcFreeColorTransform(encode[a]);
+        }
+        NcFreeColorSpace(linear);
+    }
+
+    printf(ok ? "all curves within their bounds\n" : "some curves are outside their bounds\n");
+    return ok ? 0 : 1;
+}
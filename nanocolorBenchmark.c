@@ -0,0 +1,151 @@
+//
+// Copyright 2024 Pixar
+//
+// Licensed under the Apache License, Version 2.0 (the "Apache License")
+// with the following modification; you may not use this file except in
+// compliance with the Apache License and the following modification to it:
+// Section 6. Trademarks. is deleted and replaced with:
+//
+// 6. Trademarks. This License does not grant permission to use the trade
+//    names, trademarks, service marks, or product names of the Licensor
+//    and its affiliates, except as required to comply with Section 4(c) of
+//    the License and to reproduce the content of the NOTICE file.
+//
+// You may obtain a copy of the Apache License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the Apache License with the above modification is
+// distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied. See the Apache License for the specific
+// language governing permissions and limitations under the Apache License.
+//
+
+/*
+    Measures the memory bandwidth saved by transforming a frame in a single
+    pass rather than one pass per stage. The default frame, 3840 by 2160
+    RGBA floats, is about 130MB, larger than the last level cache of current
+    CPUs, so each pass is a trip through memory. Build it with nanocolor.c,
+
+        cc -O2 nanocolorBenchmark.c nanocolor.c -lm -lpthread
+
+    and optionally give a width and height, such as 7680 4320.
+*/
+
+#include "nanocolor.h"
+#include "nanocolorProcessing.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define NC_BENCH_REPEATS 5
+
+static double _NcSeconds(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+typedef struct {
+    const char* src;
+    const char* linearSrc;   // the source gamut without its curve
+    const char* linearDst;   // the destination gamut without its curve
+    const char* dst;
+} _NcBenchPair;
+
+// Each stage of the transform as a transform of its own, so that the staged
+// passes each run a single stage over the whole frame.
+static const _NcBenchPair _ncBenchPairs[] = {
+    { "srgb_texture", "lin_srgb",     "lin_ap1",     "g22_ap1" },
+    { "g22_rec709",   "lin_rec709",   "lin_ap1",     "g18_ap1" },
+    { "adobergb",     "lin_adobergb", "lin_rec2020", "sRGB"    },
+};
+
+static void _NcBenchPairRun(const _NcBenchPair* p, const float* src, float* dst, size_t count) {
+    const NcColorSpace* cs[4] = {
+        NcGetNamedColorSpace(p->src), NcGetNamedColorSpace(p->linearSrc),
+        NcGetNamedColorSpace(p->linearDst), NcGetNamedColorSpace(p->dst)
+    };
+    for (int i = 0; i < 4; i++) {
+        if (!cs[i]) {
+            printf("unknown color space\n");
+            return;
+        }
+    }
+
+    const NcColorTransform* fused = NcGetRGBToRGBTransform(cs[0], cs[3]);
+    const NcColorTransform* stage[3] = {
+        NcGetRGBToRGBTransform(cs[0], cs[1]),
+        NcGetRGBToRGBTransform(cs[1], cs[2]),
+        NcGetRGBToRGBTransform(cs[2], cs[3])
+    };
+
+    // every pass reads and writes each pixel once
+    const double bytes = (double) count * 4 * sizeof(float) * 2;
+    double fusedTime = 1e30, stagedTime = 1e30;
+    for (int r = 0; r < NC_BENCH_REPEATS; r++) {
+        double t = _NcSeconds();
+        NcApplyTransformWithAlphaOutOfPlace(fused, src, dst, count);
+        t = _NcSeconds() - t;
+        if (t < fusedTime)
+            fusedTime = t;
+
+        t = _NcSeconds();
+        NcApplyTransformWithAlphaOutOfPlace(stage[0], src, dst, count);
+        NcApplyTransformWithAlpha(stage[1], dst, count);
+        NcApplyTransformWithAlpha(stage[2], dst, count);
+        t = _NcSeconds() - t;
+        if (t < stagedTime)
+            stagedTime = t;
+    }
+
+    printf("%s -> %s\n", p->src, p->dst);
+    printf("    one pass     %8.2f ms  %7.1f Mpixels/s  %6.2f GB/s\n",
+           fusedTime * 1e3, count / fusedTime * 1e-6, bytes / fusedTime * 1e-9);
+    printf("    three passes %8.2f ms  %7.1f Mpixels/s  %6.2f GB/s  %.2fx the time\n",
+           stagedTime * 1e3, count / stagedTime * 1e-6, 3 * bytes / stagedTime * 1e-9,
+           stagedTime / fusedTime);
+
+    NcFreeColorTransform(fused);
+    for (int i = 0; i < 3; i++)
+        NcFreeColorTransform(stage[i]);
+}
+
+int main(int argc, char** argv) {
+    size_t width = 3840, height = 2160;
+    if (argc == 3) {
+        width = (size_t) strtoul(argv[1], NULL, 10);
+        height = (size_t) strtoul(argv[2], NULL, 10);
+    }
+    const size_t count = width * height;
+    if (!count) {
+        printf("usage: %s [width height]\n", argv[0]);
+        return 1;
+    }
+
+    float* src = (float*) malloc(count * 4 * sizeof(float));
+    float* dst = (float*) malloc(count * 4 * sizeof(float));
+    if (!src || !dst) {
+        printf("couldn't allocate a %zu by %zu frame\n", width, height);
+        return 1;
+    }
+
+    // a ramp over [0, 1], touching every page of both frames before timing
+    for (size_t i = 0; i < count; i++) {
+        for (int c = 0; c < 3; c++)
+            src[i * 4 + c] = (float) ((i * 7 + (size_t) c * 31) % 1024) / 1023.f;
+        src[i * 4 + 3] = 1.f;
+    }
+    memset(dst, 0, count * 4 * sizeof(float));
+
+    printf("%zu by %zu RGBA float frame, %.1f MB\n", width, height,
+           count * 4 * sizeof(float) / (1024. * 1024.));
+    for (size_t i = 0; i < sizeof(_ncBenchPairs) / sizeof(_ncBenchPairs[0]); i++)
+        _NcBenchPairRun(&_ncBenchPairs[i], src, dst, count);
+
+    free(src);
+    free(dst);
+    return 0;
+}
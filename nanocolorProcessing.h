@@ -25,11 +25,120 @@
 #define PXR_BASE_GF_NC_NANOCOLOR_PROCESSING_H
 
 #include "nanocolor.h"
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+#define NcColorTransform NCCONCAT(NCNAMESPACE, ColorTransform)
+
+#define NcAccuracy            NCCONCAT(NCNAMESPACE, Accuracy)
+#define NcAccuracyFast        NCCONCAT(NCNAMESPACE, AccuracyFast)
+#define NcAccuracyExact       NCCONCAT(NCNAMESPACE, AccuracyExact)
+#define NcAccuracyApproximate NCCONCAT(NCNAMESPACE, AccuracyApproximate)
+
+#define NcChannelType  NCCONCAT(NCNAMESPACE, ChannelType)
+#define NcChannelFloat NCCONCAT(NCNAMESPACE, ChannelFloat)
+#define NcChannelHalf  NCCONCAT(NCNAMESPACE, ChannelHalf)
+#define NcChannelU8    NCCONCAT(NCNAMESPACE, ChannelU8)
+#define NcChannelU16   NCCONCAT(NCNAMESPACE, ChannelU16)
+#define NcImage        NCCONCAT(NCNAMESPACE, Image)
+#define NcPlanes       NCCONCAT(NCNAMESPACE, Planes)
+#define NcParallelForBody NCCONCAT(NCNAMESPACE, ParallelForBody)
+#define NcParallelForFn   NCCONCAT(NCNAMESPACE, ParallelForFn)
+
+// Opaque struct holding a precompiled transform between two color spaces.
+typedef struct NcColorTransform NcColorTransform;
+
+// NcAccuracy chooses how closely a transform follows the transfer curves,
+// trading precision for speed. Errors are relative to the reference curves,
+// which evaluate powf, for results that are normal floats. The tables used
+// for integer and half sources and for integer destinations are exact at
+// every accuracy.
+//
+// NcAccuracyFast, the default, evaluates curves with the vector kernels,
+// within 1e-5 of the reference, or 1e-6 for pure power and sRGB style curves.
+// NcAccuracyExact evaluates curves a value at a time with powf, exactly as
+// the reference does, for final frames. It is several times slower.
+// NcAccuracyApproximate evaluates pure power and sRGB style curves with a
+// shortened table kernel, within 4e-5 of the reference, or 7e-6 for the
+// built in curves, and turns denormals to 0. It suits proxies and
+// thumbnails, changing the 8 bit rounding of about one value in fifty
+// thousand. Other curves are evaluated as NcAccuracyFast evaluates them.
+typedef enum {
+    NcAccuracyFast = 0,
+    NcAccuracyExact,
+    NcAccuracyApproximate
+} NcAccuracy;
+
+// NcChannelType is the storage type of the channels of an image. Integer
+// channels are normalized so that their largest value is 1, and half
+// channels are IEEE binary16.
+typedef enum {
+    NcChannelFloat = 0,
+    NcChannelHalf,
+    NcChannelU8,
+    NcChannelU16
+} NcChannelType;
+
+// NcImage describes the pixels of an image of RGB or RGBA colors, as laid
+// out in memory by the application, such as a frame buffer with row padding
+// or interleaved AOV channels. Strides and offsets are in bytes; a negative
+// row stride describes a bottom up image, and a sub rectangle is described
+// by pointing data at its first pixel and keeping the row stride of the
+// full image. A zero initialized type means float channels.
+typedef struct {
+    void*         data;         // address of the first pixel of the first row
+    size_t        width, height;
+    ptrdiff_t     rowStride;    // bytes from the start of one row to the next
+    ptrdiff_t     pixelStride;  // bytes from the start of one pixel to the next
+    size_t        channels;     // 3 for RGB, or 4 for RGBA
+    ptrdiff_t     offsets[4];   // byte offsets of red, green, blue and alpha in a pixel
+    NcChannelType type;         // storage type of every channel
+} NcImage;
+
+// NcPlanes points at colors stored as separate planes of floats, one per
+// channel, such as renderer AOVs or image library tiles. a may be NULL if
+// there is no alpha plane.
+typedef struct {
+    float* r;
+    float* g;
+    float* b;
+    float* a;
+} NcPlanes;
+
+// NcParallelForBody does a part of a parallel transform, the items in
+// [begin, end), given the context it was handed.
+typedef void (*NcParallelForBody)(void* context, size_t begin, size_t end);
+
+// NcParallelForFn is a host supplied scheduler for the parallel transforms.
+// It must call body, with context, over ranges that together cover
+// [0, count) exactly once, on any threads and in any order, and return only
+// once they are all done. grain is a suggested range size. userData is the
+// pointer given to NcSetParallelFor.
+typedef void (*NcParallelForFn)(size_t count, size_t grain, NcParallelForBody body,
+                                void* context, void* userData);
+
 // Declare the public interface using the namespacing macro.
+#define NcApplyTransform             NCCONCAT(NCNAMESPACE, ApplyTransform)
+#define NcApplyTransformWithAlpha    NCCONCAT(NCNAMESPACE, ApplyTransformWithAlpha)
+#define NcApplyTransformOutOfPlace   NCCONCAT(NCNAMESPACE, ApplyTransformOutOfPlace)
+#define NcApplyTransformWithAlphaOutOfPlace NCCONCAT(NCNAMESPACE, ApplyTransformWithAlphaOutOfPlace)
+#define NcApplyTransformPlanar       NCCONCAT(NCNAMESPACE, ApplyTransformPlanar)
+#define NcApplyTransformParallel     NCCONCAT(NCNAMESPACE, ApplyTransformParallel)
+#define NcApplyTransformWithAlphaParallel NCCONCAT(NCNAMESPACE, ApplyTransformWithAlphaParallel)
+#define NcApplyTransformPremultiplied NCCONCAT(NCNAMESPACE, ApplyTransformPremultiplied)
+#define NcApplyTransformPremultipliedParallel NCCONCAT(NCNAMESPACE, ApplyTransformPremultipliedParallel)
+#define NcSetParallelThreshold       NCCONCAT(NCNAMESPACE, SetParallelThreshold)
+#define NcSetParallelFor             NCCONCAT(NCNAMESPACE, SetParallelFor)
+#define NcApplyTransformU8           NCCONCAT(NCNAMESPACE, ApplyTransformU8)
+#define NcApplyTransformToU8         NCCONCAT(NCNAMESPACE, ApplyTransformToU8)
+#define NcApplyTransformU16          NCCONCAT(NCNAMESPACE, ApplyTransformU16)
+#define NcApplyTransformF16          NCCONCAT(NCNAMESPACE, ApplyTransformF16)
+#define NcFreeColorTransform         NCCONCAT(NCNAMESPACE, FreeColorTransform)
+#define NcGetRGBToRGBTransform       NCCONCAT(NCNAMESPACE, GetRGBToRGBTransform)
+#define NcGetRGBToRGBTransformWithAccuracy NCCONCAT(NCNAMESPACE, GetRGBToRGBTransformWithAccuracy)
 #define NcTransformColor             NCCONCAT(NCNAMESPACE, TransformColor)
 #define NcTransformColors            NCCONCAT(NCNAMESPACE, TransformColors)
 #define NcTransformColorsWithAlpha   NCCONCAT(NCNAMESPACE, TransformColorsWithAlpha)
@@ -39,6 +148,332 @@ extern "C" {
 #define NcYxyToXYZ                   NCCONCAT(NCNAMESPACE, YxyToXYZ)
 #define NcRGBToXYZ                   NCCONCAT(NCNAMESPACE, RGBToXYZ)
 #define NcKelvinToYxy                NCCONCAT(NCNAMESPACE, KelvinToYxy)
+#define NcTransformImage             NCCONCAT(NCNAMESPACE, TransformImage)
+#define NcTransformImageParallel     NCCONCAT(NCNAMESPACE, TransformImageParallel)
+
+/**
+ * @brief Creates a transform from one color space to another.
+ * 
+ * Precomputes everything needed to move colors from the source to the
+ * destination color space; the fused RGB to RGB matrix, the parameters of
+ * both transfer curves, and the kernel that will process pixels. Creating
+ * a transform once and applying it many times avoids repeating that setup
+ * work on every call. Stages that would not change a color are dropped
+ * here, so a transform between linear spaces only multiplies by the matrix,
+ * one between spaces sharing a gamut only applies the curves, and one
+ * between spaces sharing both a gamut and a curve, such as raw and identity
+ * or sRGB and srgb_texture, leaves colors untouched. The color spaces must
+ * remain valid for the lifetime of the transform.
+ * 
+ * @param src Pointer to the source color space object.
+ * @param dst Pointer to the destination color space object.
+ * @return Pointer to the transform, or NULL if either color space is NULL.
+ */
+NCAPI const NcColorTransform* NcGetRGBToRGBTransform(const NcColorSpace* src,
+                                                     const NcColorSpace* dst);
+
+/**
+ * @brief Creates a transform from one color space to another, at a chosen accuracy.
+ * 
+ * Behaves like NcGetRGBToRGBTransform, which makes NcAccuracyFast
+ * transforms, but evaluates the transfer curves to the given accuracy, so
+ * that precision may be traded for throughput where the transform is used.
+ * Every function applying the transform honors its accuracy.
+ * 
+ * @param src Pointer to the source color space object.
+ * @param dst Pointer to the destination color space object.
+ * @param accuracy How closely the transfer curves are followed.
+ * @return Pointer to the transform, or NULL if either color space is NULL.
+ */
+NCAPI const NcColorTransform* NcGetRGBToRGBTransformWithAccuracy(const NcColorSpace* src,
+                                                                 const NcColorSpace* dst,
+                                                                 NcAccuracy accuracy);
+
+/**
+ * Frees a transform created by NcGetRGBToRGBTransform.
+ * 
+ * @param xf Pointer to the transform to free.
+ * @return void
+ */
+NCAPI void NcFreeColorTransform(const NcColorTransform* xf);
+
+/**
+ * Applies a transform to an array of colors in place.
+ * 
+ * @param xf Pointer to the transform.
+ * @param rgb Pointer to the array of RGB colors to transform.
+ * @param count Number of colors in the array.
+ * @return void
+ */
+NCAPI void NcApplyTransform(const NcColorTransform* xf, NcRGB* rgb, size_t count);
+
+/**
+ * Applies a transform to an array of colors with alpha in place. Alpha is
+ * left unchanged.
+ * 
+ * @param xf Pointer to the transform.
+ * @param rgba Pointer to the array of RGBA colors to transform.
+ * @param count Number of colors in the array.
+ * @return void
+ */
+NCAPI void NcApplyTransformWithAlpha(const NcColorTransform* xf, float* rgba, size_t count);
+
+/**
+ * @brief Applies a transform to an array of premultiplied RGBA colors in place.
+ * 
+ * Behaves like NcApplyTransformWithAlpha, but for colors premultiplied by
+ * their alpha, as in compositing buffers. Each color is divided by its
+ * alpha, transformed, and multiplied by its alpha again in a single pass,
+ * so that the transfer curves apply to the colors themselves. Colors with
+ * an alpha of 0 are transformed as though their alpha were 1, so black
+ * stays black and emissive colors, which add light without covering what
+ * is behind them, are transformed rather than lost. Alpha is left unchanged.
+ * 
+ * @param xf Pointer to the transform.
+ * @param rgba Pointer to the array of premultiplied RGBA colors to transform.
+ * @param count Number of colors in the array.
+ * @return void
+ */
+NCAPI void NcApplyTransformPremultiplied(const NcColorTransform* xf, float* rgba, size_t count);
+
+/**
+ * @brief Applies a transform to an array of colors, writing a second array.
+ * 
+ * Behaves like NcApplyTransform, but leaves the source colors unchanged,
+ * reading and writing each color once.
+ * 
+ * @param xf Pointer to the transform.
+ * @param src Pointer to the array of colors to transform.
+ * @param dst Pointer to the array of colors to write.
+ * @param count Number of colors in the array.
+ * @return void
+ */
+NCAPI void NcApplyTransformOutOfPlace(const NcColorTransform* xf, const NcRGB* src, NcRGB* dst,
+                                      size_t count);
+
+/**
+ * @brief Applies a transform to an array of RGBA colors, writing a second array.
+ * 
+ * Behaves like NcApplyTransformWithAlpha, but leaves the source colors
+ * unchanged, reading and writing each color once. Alpha is copied.
+ * 
+ * @param xf Pointer to the transform.
+ * @param src Pointer to the array of RGBA colors to transform.
+ * @param dst Pointer to the array of RGBA colors to write.
+ * @param count Number of colors in the array.
+ * @return void
+ */
+NCAPI void NcApplyTransformWithAlphaOutOfPlace(const NcColorTransform* xf, const float* src,
+                                               float* dst, size_t count);
+
+/**
+ * @brief Applies a transform to colors stored as separate planes.
+ * 
+ * Transforms count colors whose channels are stored in separate arrays.
+ * Planar colors need no interleaving, so they are handed straight to the
+ * vector kernels. The source planes are not modified unless dst points at
+ * the same planes, which transforms in place; planes must otherwise not
+ * overlap. If dst has an alpha plane, it receives the source alpha, or 1
+ * if src has none.
+ * 
+ * @param xf Pointer to the transform.
+ * @param src Pointer to the planes to read.
+ * @param dst Pointer to the planes to write.
+ * @param count Number of colors in each plane.
+ * @return void
+ */
+NCAPI void NcApplyTransformPlanar(const NcColorTransform* xf, const NcPlanes* src,
+                                  const NcPlanes* dst, size_t count);
+
+/**
+ * @brief Applies a transform to an array of colors using multiple threads.
+ * 
+ * Behaves like NcApplyTransform, but splits arrays at least as large as
+ * the parallel threshold into chunks that are transformed by a pool of
+ * worker threads, started the first time they are needed, and by the
+ * calling thread. The results are identical to NcApplyTransform. Smaller
+ * arrays, and calls made while the pool is busy, are transformed on the
+ * calling thread.
+ * 
+ * @param xf Pointer to the transform.
+ * @param rgb Pointer to the array of colors to transform.
+ * @param count Number of colors in the array.
+ * @return void
+ */
+NCAPI void NcApplyTransformParallel(const NcColorTransform* xf, NcRGB* rgb, size_t count);
+
+/**
+ * @brief Applies a transform to an array of RGBA colors using multiple threads.
+ * 
+ * Behaves like NcApplyTransformWithAlpha, splitting large arrays over
+ * threads as NcApplyTransformParallel does.
+ * 
+ * @param xf Pointer to the transform.
+ * @param rgba Pointer to the array of RGBA colors to transform.
+ * @param count Number of colors in the array.
+ * @return void
+ */
+NCAPI void NcApplyTransformWithAlphaParallel(const NcColorTransform* xf, float* rgba,
+                                             size_t count);
+
+/**
+ * @brief Applies a transform to an array of premultiplied RGBA colors using
+ * multiple threads.
+ * 
+ * Behaves like NcApplyTransformPremultiplied, splitting large arrays over
+ * threads as NcApplyTransformParallel does.
+ * 
+ * @param xf Pointer to the transform.
+ * @param rgba Pointer to the array of premultiplied RGBA colors to transform.
+ * @param count Number of colors in the array.
+ * @return void
+ */
+NCAPI void NcApplyTransformPremultipliedParallel(const NcColorTransform* xf, float* rgba,
+                                                 size_t count);
+
+/**
+ * @brief Sets the size below which parallel transforms run serially.
+ * 
+ * Splitting work over threads costs some synchronization, which isn't
+ * repaid by small calls. Arrays and images with fewer colors than the
+ * threshold are transformed on the calling thread. The default is 65536.
+ * This should be set before any parallel transforms are running.
+ * 
+ * @param count The smallest number of colors to transform in parallel.
+ * @return void
+ */
+NCAPI void NcSetParallelThreshold(size_t count);
+
+/**
+ * @brief Installs a host scheduler for the parallel transforms.
+ * 
+ * By default, the parallel transforms use a pool of worker threads that
+ * Nanocolor starts the first time it's needed, or run serially if
+ * Nanocolor was built with NC_NO_THREADS. An application that already
+ * has a scheduler, such as TBB or its own work stealing pool, may install
+ * it here so that Nanocolor's work nests within the application's and no
+ * further threads are started. Calls below the parallel threshold still
+ * run on the calling thread without calling the scheduler. This should be
+ * set before any parallel transforms are running.
+ * 
+ * @param parallelFor The scheduler, or NULL to restore the default.
+ * @param userData A pointer passed through to the scheduler.
+ * @return void
+ */
+NCAPI void NcSetParallelFor(NcParallelForFn parallelFor, void* userData);
+
+/**
+ * @brief Applies a transform to an array of 8 bit colors.
+ * 
+ * Decodes 8 bit RGB or RGBA colors through a table built from the source
+ * color space's curve the first time it is needed, and writes floating point
+ * colors in the destination color space. Alpha is scaled to [0, 1] and
+ * otherwise left unchanged.
+ * 
+ * @param xf Pointer to the transform.
+ * @param src Pointer to the array of 8 bit colors.
+ * @param dst Pointer to the array of floating point colors to write.
+ * @param channels 3 for RGB colors, or 4 for RGBA colors.
+ * @param count Number of colors in the array.
+ * @return void
+ */
+NCAPI void NcApplyTransformU8(const NcColorTransform* xf, const uint8_t* src, float* dst,
+                              size_t channels, size_t count);
+
+/**
+ * @brief Applies a transform to an array of colors, writing 8 bit colors.
+ * 
+ * Transforms floating point RGB or RGBA colors, such as a rendered frame,
+ * and writes 8 bit colors for display, such as a review movie or a
+ * thumbnail. The result is exactly the destination curve's value rounded to
+ * 8 bits, but is found by a table lookup built once per color space rather
+ * than by evaluating the curve. Out of range values clamp, and NaN becomes
+ * zero. Alpha is rounded to 8 bits.
+ * 
+ * @param xf Pointer to the transform.
+ * @param src Pointer to the array of floating point colors.
+ * @param dst Pointer to the array of 8 bit colors to write.
+ * @param channels 3 for RGB colors, or 4 for RGBA colors.
+ * @param count Number of colors in the array.
+ * @return void
+ */
+NCAPI void NcApplyTransformToU8(const NcColorTransform* xf, const float* src, uint8_t* dst,
+                                size_t channels, size_t count);
+
+/**
+ * @brief Applies a transform to an array of 16 bit colors.
+ * 
+ * Decodes 16 bit RGB or RGBA colors through a table built from the source
+ * color space's curve the first time it is needed, and writes 16 bit colors
+ * in the destination color space, rounded to nearest and clamped to the
+ * representable range. Each code is exactly the reference curve's, rounded,
+ * at every accuracy, as the curve's result is checked against a table of the
+ * linear values at which the codes change. Alpha is copied unchanged. src
+ * and dst may be the same array to transform in place.
+ * 
+ * @param xf Pointer to the transform.
+ * @param src Pointer to the array of 16 bit colors.
+ * @param dst Pointer to the array of 16 bit colors to write.
+ * @param channels 3 for RGB colors, or 4 for RGBA colors.
+ * @param count Number of colors in the array.
+ * @return void
+ */
+NCAPI void NcApplyTransformU16(const NcColorTransform* xf, const uint16_t* src, uint16_t* dst,
+                               size_t channels, size_t count);
+
+/**
+ * @brief Applies a transform to an array of half float colors.
+ * 
+ * Reads and writes RGB or RGBA colors stored as IEEE binary16, passed as
+ * their bit patterns, such as the pixels of a half float OpenEXR image.
+ * A curved source color space is removed through a table indexed by the
+ * half's bit pattern, built the first time it is needed. Results round to
+ * the nearest half, overflow to infinity, and NaN is preserved. Alpha is
+ * copied unchanged. src and dst may be the same array to transform in place.
+ * 
+ * @param xf Pointer to the transform.
+ * @param src Pointer to the array of half float colors.
+ * @param dst Pointer to the array of half float colors to write.
+ * @param channels 3 for RGB colors, or 4 for RGBA colors.
+ * @param count Number of colors in the array.
+ * @return void
+ */
+NCAPI void NcApplyTransformF16(const NcColorTransform* xf, const uint16_t* src, uint16_t* dst,
+                               size_t channels, size_t count);
+
+/**
+ * @brief Applies a transform to an image.
+ * 
+ * Reads the pixels described by src, transforms them, and writes them to
+ * the pixels described by dst in a single pass, without repacking either
+ * image. The images may have different channel types, for example to
+ * convert 8 bit texels to half floats. src and dst may describe the same
+ * pixels to transform in place. If dst has an alpha channel, it receives
+ * the source alpha converted to the destination's channel type, or 1 if
+ * src has none. Nothing is done if the images' sizes differ.
+ * 
+ * @param xf Pointer to the transform.
+ * @param src Pointer to the description of the source image.
+ * @param dst Pointer to the description of the destination image.
+ * @return void
+ */
+NCAPI void NcTransformImage(const NcColorTransform* xf, const NcImage* src, const NcImage* dst);
+
+/**
+ * @brief Applies a transform to an image using multiple threads.
+ * 
+ * Behaves like NcTransformImage, but splits images with at least as many
+ * pixels as the parallel threshold into bands of rows, transformed as
+ * NcApplyTransformParallel does. The results are identical to
+ * NcTransformImage.
+ * 
+ * @param xf Pointer to the transform.
+ * @param src Pointer to the description of the source image.
+ * @param dst Pointer to the description of the destination image.
+ * @return void
+ */
+NCAPI void NcTransformImageParallel(const NcColorTransform* xf, const NcImage* src,
+                                    const NcImage* dst);
 
 /**
  * Transforms a color from one color space to another.